@@ -1,8 +1,11 @@
 #!/bin/sh
 
 mkdir -p build
-pushd build
+cd build
 
+# cleancode: scalar and SSE kernels (SSE2 is baseline on x86-64)
+# cleancode_avx2: adds the AVX kernels
 g++ ../cleancode.cpp -ocleancode -std=c++17 -O3
+g++ ../cleancode.cpp -ocleancode_avx2 -std=c++17 -O3 -mavx2
 
-popd
\ No newline at end of file
+cd ..
@@ -3,8 +3,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
 
 typedef float f32;
+typedef double f64;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
@@ -22,19 +26,213 @@ typedef uint64_t u64;
 #error missing OS detection
 #endif
 
+//- Compiler hints
+#if defined(_MSC_VER)
+#define AssumeAligned(Pointer, Alignment) (__assume(((uintptr_t)(Pointer) & ((Alignment) - 1)) == 0), (Pointer))
+#else
+#define AssumeAligned(Pointer, Alignment) ((decltype(Pointer))__builtin_assume_aligned((Pointer), (Alignment)))
+#endif
+
 //- High precision OS measurement implementations
 #if OS_WINDOWS
 #include "cleancode_windows.cpp"
+#elif OS_LINUX
+#include "cleancode_linux.cpp"
+#else
+#error missing OS implementation
+#endif
+
+//- SIMD kernels
+// The SSE kernels need SSE2, which every x86-64 target has. The AVX kernels also need AVX
+// code generation (g++ -mavx2; MSVC emits it on request). -DCLEANCODE_SIMD=0 or
+// -DCLEANCODE_AVX=0 drop the respective kernels.
+#ifndef CLEANCODE_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLEANCODE_SIMD 1
+#else
+#define CLEANCODE_SIMD 0
+#endif
+#endif
+
+#ifndef CLEANCODE_AVX
+#if CLEANCODE_SIMD && (defined(_MSC_VER) || defined(__AVX__))
+#define CLEANCODE_AVX 1
+#else
+#define CLEANCODE_AVX 0
+#endif
+#endif
 
+#if CLEANCODE_SIMD
 #include <xmmintrin.h>
+#endif
+
+#if CLEANCODE_AVX
 #include <immintrin.h>
+#endif
+
+//- Tracing
+// Build with -DCLEANCODE_TRACE=1 to record TimeBlock scopes into per-thread ring buffers
+// and write them as Chrome trace-event JSON (chrome://tracing, Perfetto) on exit.
+// With tracing off TimeBlock expands to nothing.
+#ifndef CLEANCODE_TRACE
+#define CLEANCODE_TRACE 0
+#endif
+
+#if CLEANCODE_TRACE
+
+#include <atomic>
+
+#define TRACE_BUFFER_EVENT_COUNT 65536 // must be a power of two
+#define TRACE_MAX_THREAD_COUNT 64
+
+struct trace_event
+{
+   char const *Name;
+   u64 BeginTSC;
+   u64 EndTSC;
+};
+
+struct trace_buffer
+{
+   u32 ThreadIndex;
+   u64 EventCount;
+   trace_event Events[TRACE_BUFFER_EVENT_COUNT];
+};
+
+trace_buffer *TraceBuffers[TRACE_MAX_THREAD_COUNT];
+std::atomic<u32> TraceThreadCount;
+thread_local trace_buffer *ThreadTraceBuffer;
+
+// Tracing more than TRACE_MAX_THREAD_COUNT threads, or failing to allocate a buffer, aborts
+// rather than dropping events silently.
+trace_buffer *GetThreadTraceBuffer(void)
+{
+   trace_buffer *Buffer = ThreadTraceBuffer;
+   if (!Buffer)
+   {
+      u32 ThreadIndex = TraceThreadCount.fetch_add(1);
+      if (ThreadIndex >= TRACE_MAX_THREAD_COUNT)
+      {
+         fprintf(stderr, "trace: more than %d traced threads\n", TRACE_MAX_THREAD_COUNT);
+         abort();
+      }
+      
+      Buffer = (trace_buffer *)calloc(1, sizeof(*Buffer));
+      if (!Buffer)
+      {
+         fprintf(stderr, "trace: failed to allocate the buffer for thread %u\n", ThreadIndex);
+         abort();
+      }
+      
+      Buffer->ThreadIndex = ThreadIndex;
+      TraceBuffers[ThreadIndex] = Buffer;
+      ThreadTraceBuffer = Buffer;
+   }
+   
+   return Buffer;
+}
+
+struct trace_scope
+{
+   char const *Name;
+   u64 BeginTSC;
+   
+   trace_scope(char const *Name) : Name(Name), BeginTSC(ReadCPUTimer()) {}
+   ~trace_scope()
+   {
+      u64 EndTSC = ReadCPUTimer();
+      trace_buffer *Buffer = GetThreadTraceBuffer();
+      trace_event *Event = Buffer->Events + (Buffer->EventCount++ & (TRACE_BUFFER_EVENT_COUNT - 1));
+      Event->Name = Name;
+      Event->BeginTSC = BeginTSC;
+      Event->EndTSC = EndTSC;
+   }
+};
+
+#define TraceConcat_(A, B) A##B
+#define TraceConcat(A, B) TraceConcat_(A, B)
+#define TimeBlock(Name) trace_scope TraceConcat(TraceScope, __LINE__)(Name)
+
+u64 EstimateCPUTimerFrequency(void)
+{
+   u64 const WaitNSec = 10000000;
+   
+   timestamp BeginTs;
+   BeginTimeMeasurement(&BeginTs);
+   u64 BeginTSC = ReadCPUTimer();
+   
+   u64 ElapsedNSec = 0;
+   while (ElapsedNSec < WaitNSec)
+   {
+      ElapsedNSec = EndTimeMeasurement(BeginTs);
+   }
+   
+   u64 Result = (ReadCPUTimer() - BeginTSC) * 1000000000 / ElapsedNSec;
+   return Result;
+}
+
+// Call once all traced threads are done. Only the newest TRACE_BUFFER_EVENT_COUNT
+// events of each thread survive.
+bool WriteChromeTrace(char const *Path)
+{
+   FILE *File = fopen(Path, "w");
+   if (!File)
+   {
+      return false;
+   }
+   
+   f64 MicrosecondsPerTick = 1000000.0 / EstimateCPUTimerFrequency();
+   u32 ThreadCount = TraceThreadCount.load();
+   
+   u64 FirstTSC = ~0ull;
+   for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+   {
+      trace_buffer *Buffer = TraceBuffers[ThreadIndex];
+      u64 EventCount = (Buffer->EventCount < TRACE_BUFFER_EVENT_COUNT) ? Buffer->EventCount : TRACE_BUFFER_EVENT_COUNT;
+      for (u64 EventIndex = 0; EventIndex < EventCount; ++EventIndex)
+      {
+         if (Buffer->Events[EventIndex].BeginTSC < FirstTSC) FirstTSC = Buffer->Events[EventIndex].BeginTSC;
+      }
+   }
+   
+   fprintf(File, "{\"traceEvents\":[\n");
+   char const *Separator = "";
+   for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+   {
+      trace_buffer *Buffer = TraceBuffers[ThreadIndex];
+      u64 FirstEvent = (Buffer->EventCount > TRACE_BUFFER_EVENT_COUNT) ? Buffer->EventCount - TRACE_BUFFER_EVENT_COUNT : 0;
+      for (u64 EventIndex = FirstEvent; EventIndex < Buffer->EventCount; ++EventIndex)
+      {
+         trace_event *Event = Buffer->Events + (EventIndex & (TRACE_BUFFER_EVENT_COUNT - 1));
+         fprintf(File, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                 Separator, Event->Name, Buffer->ThreadIndex,
+                 (Event->BeginTSC - FirstTSC) * MicrosecondsPerTick,
+                 (Event->EndTSC - Event->BeginTSC) * MicrosecondsPerTick);
+         Separator = ",\n";
+      }
+   }
+   fprintf(File, "\n]}\n");
+   
+   bool Result = (fclose(File) == 0);
+   return Result;
+}
 
-#elif OS_LINUX
-#include "cleancode_linux.cpp"
 #else
-#error missing OS implementation
+
+#define TimeBlock(Name)
+
 #endif
 
+enum shape_type : u32
+{
+   Shape_Square,
+   Shape_Rectangle,
+   Shape_Triangle,
+   Shape_Circle,
+   
+   Shape_Count,
+};
+
 class shape_base
 {
    public:
@@ -42,6 +240,7 @@ class shape_base
    shape_base() {}
    virtual f32 Area() = 0;
    virtual u32 CornerCount() = 0;
+   virtual shape_type Type() = 0;
 };
 
 class square : public shape_base
@@ -51,6 +250,7 @@ class square : public shape_base
    square(f32 Side) : Side(Side) {}
    virtual f32 Area() { return Side*Side; }
    virtual u32 CornerCount() { return 4; }
+   virtual shape_type Type() { return Shape_Square; }
    
    private:
    
@@ -64,6 +264,7 @@ class rectangle : public shape_base
    rectangle(f32 Width, f32 Height) : Width(Width), Height(Height) {}
    virtual f32 Area() { return Width*Height; }
    virtual u32 CornerCount() { return 4; }
+   virtual shape_type Type() { return Shape_Rectangle; }
    
    private:
    
@@ -78,6 +279,7 @@ class triangle : public shape_base
    triangle(f32 Base, f32 Height) : Base(Base), Height(Height) {}
    virtual f32 Area() { return 0.5f*Base*Height; }
    virtual u32 CornerCount() { return 3; }
+   virtual shape_type Type() { return Shape_Triangle; }
    
    private:
    
@@ -92,6 +294,7 @@ class circle : public shape_base
    circle(f32 Radius) : Radius(Radius) {}
    virtual f32 Area() { return Pi32*Radius*Radius; }
    virtual u32 CornerCount() { return 0; }
+   virtual shape_type Type() { return Shape_Circle; }
    
    private:
    
@@ -131,16 +334,6 @@ f32 CornerAreaVTBL4(u32 ShapeCount, shape_base **Shapes)
    return Result;
 }
 
-enum shape_type : u32
-{
-   Shape_Square,
-   Shape_Rectangle,
-   Shape_Triangle,
-   Shape_Circle,
-   
-   Shape_Count,
-};
-
 struct shape_union
 {
    shape_type Type;
@@ -257,6 +450,63 @@ f32 CornerAreaTable4(u32 ShapeCount, shape_union *Shapes)
    return Result;
 }
 
+// Same coefficients as CTable, selected with integer masks instead of an indexed load.
+// Multiplying by (f32)(Type == X) instead gets folded back into branches by GCC.
+f32 GetCornerAreaBranchless(shape_union Shape)
+{
+   u32 const QuadCoefficient = 0x3e4ccccd;     // 1.0f / (1.0f + 4.0f)
+   u32 const TriangleCoefficient = 0x3e000000; // 0.5f / (1.0f + 3.0f)
+   u32 const CircleCoefficient = 0x40490fdb;   // Pi32
+   
+   u32 Type = Shape.Type;
+   u32 CoefficientBits = (((0u - (u32)(Type <= Shape_Rectangle)) & QuadCoefficient) |
+                          ((0u - (u32)(Type == Shape_Triangle)) & TriangleCoefficient) |
+                          ((0u - (u32)(Type == Shape_Circle)) & CircleCoefficient));
+   f32 Coefficient;
+   memcpy(&Coefficient, &CoefficientBits, sizeof(Coefficient));
+   
+   f32 Result = Coefficient*Shape.Width*Shape.Height;
+   return Result;
+}
+
+// Portable kernel for targets without the SSE/AVX paths. LaneCount independent
+// accumulators let the compiler vectorize the sum without reassociating it.
+template <u32 LaneCount>
+f32 CornerAreaBranchless(u32 ShapeCount, shape_union *Shapes)
+{
+   shape_union const *__restrict At = AssumeAligned(Shapes, alignof(shape_union));
+   f32 Accum[LaneCount] = {};
+   
+   u32 Count = ShapeCount/LaneCount;
+   while (Count--)
+   {
+      for (u32 Lane = 0; Lane < LaneCount; ++Lane)
+      {
+         Accum[Lane] += GetCornerAreaBranchless(At[Lane]);
+      }
+      
+      At += LaneCount;
+   }
+   
+   for (u32 Remaining = ShapeCount % LaneCount; Remaining; --Remaining)
+   {
+      Accum[0] += GetCornerAreaBranchless(*At++);
+   }
+   
+   for (u32 Width = LaneCount/2; Width; Width /= 2)
+   {
+      for (u32 Lane = 0; Lane < Width; ++Lane)
+      {
+         Accum[Lane] += Accum[Lane + Width];
+      }
+   }
+   
+   f32 Result = Accum[0];
+   return Result;
+}
+
+#if CLEANCODE_SIMD
+
 __m128 GetCornerAreaTableSIMD(shape_union *BaseShape)
 {
    __m128 Multiplier = _mm_set_ps(CTable[BaseShape->Type],
@@ -360,6 +610,10 @@ f32 CornerAreaTableSIMD4(u32 ShapeCount, shape_union *Shapes)
    return Result;
 }
 
+#endif
+
+#if CLEANCODE_AVX
+
 __m256 GetCornerAreaTableSIMD256(shape_union *BaseShape)
 {
    __m256 Multiplier = _mm256_set_ps(CTable[BaseShape->Type],
@@ -475,187 +729,1259 @@ f32 CornerAreaTableSIMD256_4(u32 ShapeCount, shape_union *Shapes)
    return Result;
 }
 
-f32 MeasureVTBL(f32 (*Function)(u32, shape_base **),
-                u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount)
+#endif
+
+//- Reordering by shape type
+// Grouping shapes of the same type together makes the type-dependent branches
+// (switch cases, virtual calls) predictable. With only Shape_Count buckets a single
+// counting pass plus an in-place cycle-swap pass (American flag sort) is enough.
+
+shape_type GetShapeType(shape_union Shape) { return Shape.Type; }
+shape_type GetShapeType(shape_base *Shape) { return Shape->Type(); }
+
+template <typename shape>
+void ReorderShapesByType(u32 ShapeCount, shape *Shapes)
 {
-   f32 BestMeasurement = INFINITY;
-   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   u32 BucketEnd[Shape_Count] = {};
+   for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+   {
+      ++BucketEnd[GetShapeType(Shapes[ShapeIndex])];
+   }
+   
+   u32 Next[Shape_Count];
+   u32 Offset = 0;
+   for (u32 Bucket = 0; Bucket < Shape_Count; ++Bucket)
+   {
+      Next[Bucket] = Offset;
+      Offset += BucketEnd[Bucket];
+      BucketEnd[Bucket] = Offset;
+   }
+   
+   for (u32 Bucket = 0; Bucket < Shape_Count; ++Bucket)
    {
-      shape_base **Shapes = (shape_base **)malloc(ShapeCount * sizeof(*Shapes));
-      for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+      while (Next[Bucket] < BucketEnd[Bucket])
       {
-         u32 ShapeType = rand() % 4;
-         switch (ShapeType)
+         shape Shape = Shapes[Next[Bucket]];
+         shape_type Type = GetShapeType(Shape);
+         while (Type != Bucket)
          {
-            case 0: { Shapes[ShapeIndex] = new square(rand()); } break;
-            case 1: { Shapes[ShapeIndex] = new rectangle(rand(), rand()); } break;
-            case 2: { Shapes[ShapeIndex] = new triangle(rand(), rand()); } break;
-            case 3: { Shapes[ShapeIndex] = new circle(rand()); } break;
-            
-            default: { assert(false); } break;
+            shape Displaced = Shapes[Next[Type]];
+            Shapes[Next[Type]++] = Shape;
+            Shape = Displaced;
+            Type = GetShapeType(Shape);
          }
+         
+         Shapes[Next[Bucket]++] = Shape;
       }
-      
-      timestamp BeginTs;
-      BeginTimeMeasurement(&BeginTs);
-      
-      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
-      {
-         f32 TotalArea = Function(ShapeCount, Shapes);
-      }
-      
-      u64 MeasurementNSec = EndTimeMeasurement(BeginTs);
-      
-      f32 Measurement = (f32)MeasurementNSec / (RepeatCount * ShapeCount);
-      if (Measurement < BestMeasurement)
-      {
-         BestMeasurement = Measurement;
-      }
-      
-      for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
-      {
-         delete Shapes[ShapeIndex];
-      }
-      free(Shapes);
+   }
+}
+
+void ReorderUnionByType(u32 ShapeCount, shape_union *Shapes)
+{
+   ReorderShapesByType(ShapeCount, Shapes);
+}
+
+void ReorderVTBLByType(u32 ShapeCount, shape_base **Shapes)
+{
+   ReorderShapesByType(ShapeCount, Shapes);
+}
+
+// For data that changes rarely: keeps Shapes grouped by type across inserts and
+// removals, moving at most one shape per bucket instead of resorting.
+template <typename shape>
+struct sorted_shape_array
+{
+   u32 Count;
+   u32 Capacity;
+   shape *Shapes;
+   u32 BucketEnd[Shape_Count];
+};
+
+// Failing to allocate, inserting past Capacity or removing an out-of-range index aborts,
+// like running out of shape arena space.
+template <typename shape>
+sorted_shape_array<shape> MakeSortedShapeArray(u32 Capacity)
+{
+   sorted_shape_array<shape> Result = {};
+   Result.Capacity = Capacity;
+   Result.Shapes = (shape *)malloc((u64)Capacity * sizeof(*Result.Shapes));
+   if (!Result.Shapes)
+   {
+      fprintf(stderr, "sorted shape array: failed to allocate %u shapes\n", Capacity);
+      abort();
    }
    
-   return BestMeasurement;
+   return Result;
 }
 
-volatile f32 AntiUnusedThrowAwayRegister;
+template <typename shape>
+void FreeSortedShapeArray(sorted_shape_array<shape> *Array)
+{
+   free(Array->Shapes);
+   *Array = {};
+}
 
-f32 MeasureUnion(f32 (*Function)(u32, shape_union *),
-                 u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount)
+template <typename shape>
+void InsertSorted(sorted_shape_array<shape> *Array, shape Shape)
 {
-   f32 BestMeasurement = INFINITY;
-   f32 TotalAreaAccum = 0.0f;
-   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   if (Array->Count >= Array->Capacity)
    {
-      shape_union *Shapes = (shape_union *)malloc(ShapeCount * sizeof(*Shapes));
-      for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
-      {
-         shape_union Shape;
-         Shape.Type = (shape_type)(rand() % 4);
-         Shape.Width = rand();
-         Shape.Height = rand();
-         switch (Shape.Type)
-         {
-            case Shape_Square:
-            case Shape_Circle: { Shape.Height = Shape.Width; } break;
-         }
-         
-         Shapes[ShapeIndex] = Shape;
-      }
-      
-      timestamp BeginTs;
-      BeginTimeMeasurement(&BeginTs);
-      
-      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
-      {
-         f32 TotalArea = Function(ShapeCount, Shapes);
-         TotalAreaAccum += TotalArea;
-      }
-      
-      u64 MeasurementNSec = EndTimeMeasurement(BeginTs);
-      
-      f32 Measurement = (f32)MeasurementNSec / (RepeatCount * ShapeCount);
-      if (Measurement < BestMeasurement)
-      {
-         BestMeasurement = Measurement;
-      }
-      
-      free(Shapes);
+      fprintf(stderr, "sorted shape array full: capacity %u\n", Array->Capacity);
+      abort();
    }
    
-   AntiUnusedThrowAwayRegister += TotalAreaAccum;
+   // Open a hole at the end and walk it down to the end of Shape's bucket
+   // by moving the first shape of every later bucket to that bucket's end.
+   shape_type Type = GetShapeType(Shape);
+   u32 Hole = Array->Count;
+   for (u32 Bucket = Shape_Count - 1; Bucket > Type; --Bucket)
+   {
+      u32 BucketBegin = Array->BucketEnd[Bucket - 1];
+      Array->Shapes[Hole] = Array->Shapes[BucketBegin];
+      Hole = BucketBegin;
+      ++Array->BucketEnd[Bucket];
+   }
    
-   return BestMeasurement;
+   Array->Shapes[Hole] = Shape;
+   ++Array->BucketEnd[Type];
+   ++Array->Count;
 }
 
-void Measure(u32 RepeatCount)
+// Returns the removed shape so collections of shape_base * can release it.
+template <typename shape>
+shape RemoveSorted(sorted_shape_array<shape> *Array, u32 ShapeIndex)
 {
-   printf("Repeat Count: %d\n", RepeatCount);
+   if (ShapeIndex >= Array->Count)
+   {
+      fprintf(stderr, "sorted shape array: removing index %u of %u shapes\n", ShapeIndex, Array->Count);
+      abort();
+   }
    
-   printf("\n");
+   // Fill the hole with the last shape of its bucket, then walk the new hole
+   // up by moving the last shape of every later bucket into it.
+   shape Result = Array->Shapes[ShapeIndex];
+   u32 Hole = ShapeIndex;
+   for (u32 Bucket = GetShapeType(Result); Bucket < Shape_Count; ++Bucket)
+   {
+      u32 BucketLast = --Array->BucketEnd[Bucket];
+      Array->Shapes[Hole] = Array->Shapes[BucketLast];
+      Hole = BucketLast;
+   }
    
-   u32 ShapeCount = 1048576;
-   u32 MeasurementsPerTest = 10;
+   --Array->Count;
    
-   printf("%30s(%d): ", "CornerAreaVTBL", ShapeCount); fflush(stdout);
-   f32 MeasurementVTBL = MeasureVTBL(&CornerAreaVTBL, ShapeCount, MeasurementsPerTest, RepeatCount);
-   printf("%f ns/shape\n", MeasurementVTBL);
+   return Result;
+}
+
+//- Shape snapshots
+// A snapshot stores a shape_union array exactly as the kernels consume it, preceded by
+// a fixed header with cached aggregates. Loading maps the file and points straight at
+// the shapes; the only optional pass over the data is verification (checksum and types).
+
+#define SNAPSHOT_MAGIC 0x50534343 // "CCSP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SHAPES_ALIGNMENT 64
+
+enum snapshot_flags : u32
+{
+   SnapshotFlag_SortedByType = 0x1,
+};
+
+struct snapshot_header
+{
+   u32 Magic;
+   u32 Version;
+   u32 HeaderSize;
+   u32 ShapeSize;
+   
+   u32 ShapeCount;
+   u32 Flags;
+   u64 ShapesOffset;
+   
+   u64 Checksum;
+   f32 TotalCornerArea;
+   u32 TypeCount[Shape_Count];
+   u32 Reserved;
+};
+
+static_assert(sizeof(shape_union) == 12, "snapshot layout depends on shape_union");
+static_assert(sizeof(snapshot_header) == SNAPSHOT_SHAPES_ALIGNMENT, "shapes must start right after the header");
+
+// Shapes points into a read-only mapping. The kernels only read through it, but any
+// in-place operation (ReorderUnionByType, editing a shape) faults instead of failing to
+// compile: the pointer is not const only because the kernels take shape_union *.
+// Copy the shapes out before modifying them.
+struct shape_snapshot
+{
+   u32 ShapeCount;
+   u32 Flags;
+   shape_union *Shapes;
+   f32 TotalCornerArea;
+   u32 TypeCount[Shape_Count];
    
-   printf("%30s(%d): ", "CornerAreaVTBL4", ShapeCount); fflush(stdout);
-   f32 MeasurementVTBL4 = MeasureVTBL(&CornerAreaVTBL4, ShapeCount, MeasurementsPerTest, RepeatCount);
-   printf("%f ns/shape\n", MeasurementVTBL4);
+   mapped_file File;
+};
+
+// Four independent multiply-xor lanes over 8-byte words, so verifying a mapped snapshot
+// runs close to memory bandwidth.
+u64 SnapshotChecksum(void const *Data, u64 Size, u64 Seed)
+{
+   u64 const Prime = 0x100000001b3ull;
+   u64 Lane[4] = { Seed ^ 0xcbf29ce484222325ull, Seed + 1, Seed + 2, Seed + 3 };
    
-   printf("%30s(%d): ", "CornerAreaSwitch", ShapeCount); fflush(stdout);
-   f32 MeasurementSwitch = MeasureUnion(&CornerAreaSwitch, ShapeCount, MeasurementsPerTest, RepeatCount);
-   printf("%f ns/shape\n", MeasurementSwitch);
+   unsigned char const *At = (unsigned char const *)Data;
+   u64 BlockCount = Size / 32;
+   for (u64 BlockIndex = 0; BlockIndex < BlockCount; ++BlockIndex)
+   {
+      for (u32 LaneIndex = 0; LaneIndex < 4; ++LaneIndex)
+      {
+         u64 Word;
+         memcpy(&Word, At + 8*LaneIndex, sizeof(Word));
+         Lane[LaneIndex] = (Lane[LaneIndex] ^ Word) * Prime;
+      }
+      At += 32;
+   }
    
-   printf("%30s(%d): ", "CornerAreaSwitch4", ShapeCount); fflush(stdout);
-   f32 MeasurementSwitch4 = MeasureUnion(&CornerAreaSwitch4, ShapeCount, MeasurementsPerTest, RepeatCount);
-   printf("%f ns/shape\n", MeasurementSwitch4);
+   u64 Result = Lane[0] ^ (Lane[1] * 3) ^ (Lane[2] * 5) ^ (Lane[3] * 7) ^ Size;
+   for (u64 Remaining = Size % 32; Remaining; --Remaining)
+   {
+      Result = (Result ^ *At++) * Prime;
+   }
    
-   printf("%30s(%d): ", "CornerAreaTable", ShapeCount); fflush(stdout);
-   f32 MeasurementTable = MeasureUnion(&CornerAreaTable, ShapeCount, MeasurementsPerTest, RepeatCount);
+   return Result;
+}
+
+u64 SnapshotChecksum(snapshot_header const *Header, shape_union const *Shapes)
+{
+   snapshot_header HeaderCopy = *Header;
+   HeaderCopy.Checksum = 0;
+   
+   u64 Result = SnapshotChecksum(&HeaderCopy, sizeof(HeaderCopy), 0);
+   Result = SnapshotChecksum(Shapes, (u64)Header->ShapeCount * sizeof(*Shapes), Result);
+   
+   return Result;
+}
+
+// Shapes is written as given; callers that want SnapshotFlag_SortedByType reorder first
+// (ReorderUnionByType). The flag is set when the shapes are grouped by type.
+bool WriteSnapshot(char const *Path, u32 ShapeCount, shape_union const *Shapes)
+{
+   TimeBlock("WriteSnapshot");
+   
+   snapshot_header Header = {};
+   Header.Magic = SNAPSHOT_MAGIC;
+   Header.Version = SNAPSHOT_VERSION;
+   Header.HeaderSize = sizeof(Header);
+   Header.ShapeSize = sizeof(*Shapes);
+   Header.ShapeCount = ShapeCount;
+   Header.ShapesOffset = SNAPSHOT_SHAPES_ALIGNMENT;
+   
+   f32 TotalCornerArea = 0.0f;
+   bool Sorted = true;
+   for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+   {
+      TotalCornerArea += GetCornerAreaTable(Shapes[ShapeIndex]);
+      ++Header.TypeCount[Shapes[ShapeIndex].Type];
+      Sorted = Sorted && (ShapeIndex == 0 || Shapes[ShapeIndex].Type >= Shapes[ShapeIndex - 1].Type);
+   }
+   Header.Flags = Sorted ? SnapshotFlag_SortedByType : 0;
+   Header.TotalCornerArea = TotalCornerArea;
+   Header.Checksum = SnapshotChecksum(&Header, Shapes);
+   
+   bool Result = false;
+   FILE *File = fopen(Path, "wb");
+   if (File)
+   {
+      Result = (fwrite(&Header, sizeof(Header), 1, File) == 1 &&
+                fwrite(Shapes, sizeof(*Shapes), ShapeCount, File) == ShapeCount);
+      Result = (fclose(File) == 0) && Result;
+   }
+   
+   return Result;
+}
+
+// Full pass over the payload: every Type must be a valid CTable index, the per-type
+// counts must match the header, and SortedByType snapshots must actually be grouped.
+bool ValidateSnapshotShapes(snapshot_header const *Header, shape_union const *Shapes)
+{
+   u32 TypeCount[Shape_Count] = {};
+   u32 PreviousType = 0;
+   bool Sorted = true;
+   for (u32 ShapeIndex = 0; ShapeIndex < Header->ShapeCount; ++ShapeIndex)
+   {
+      u32 Type = Shapes[ShapeIndex].Type;
+      if (Type >= Shape_Count)
+      {
+         return false;
+      }
+      
+      ++TypeCount[Type];
+      Sorted = Sorted && (Type >= PreviousType);
+      PreviousType = Type;
+   }
+   
+   bool Result = (!(Header->Flags & SnapshotFlag_SortedByType) || Sorted);
+   for (u32 Type = 0; Type < Shape_Count; ++Type)
+   {
+      Result = Result && (TypeCount[Type] == Header->TypeCount[Type]);
+   }
+   
+   return Result;
+}
+
+// VerifyChecksum = false only checks the header, so use it only for trusted files: a
+// corrupted Type in the payload would index CTable out of bounds in the table kernels.
+// VerifyChecksum = true also checks the checksum and every shape's type.
+bool LoadSnapshot(char const *Path, shape_snapshot *Snapshot, bool VerifyChecksum)
+{
+   TimeBlock("LoadSnapshot");
+   
+   *Snapshot = {};
+   
+   mapped_file File = MapFileReadOnly(Path);
+   snapshot_header const *Header = (snapshot_header const *)File.Data;
+   
+   bool Result = (File.Data &&
+                  File.Size >= SNAPSHOT_SHAPES_ALIGNMENT &&
+                  Header->Magic == SNAPSHOT_MAGIC &&
+                  Header->Version == SNAPSHOT_VERSION &&
+                  Header->HeaderSize == sizeof(snapshot_header) &&
+                  Header->ShapeSize == sizeof(shape_union) &&
+                  Header->ShapesOffset == SNAPSHOT_SHAPES_ALIGNMENT &&
+                  File.Size == Header->ShapesOffset + (u64)Header->ShapeCount * sizeof(shape_union) &&
+                  (Header->Flags & ~(u32)SnapshotFlag_SortedByType) == 0);
+   
+   if (Result)
+   {
+      u64 TypeCountSum = 0;
+      for (u32 Type = 0; Type < Shape_Count; ++Type)
+      {
+         TypeCountSum += Header->TypeCount[Type];
+      }
+      Result = (TypeCountSum == Header->ShapeCount);
+   }
+   
+   shape_union *Shapes = Result ? (shape_union *)((unsigned char *)File.Data + Header->ShapesOffset) : 0;
+   if (Result && VerifyChecksum)
+   {
+      Result = (SnapshotChecksum(Header, Shapes) == Header->Checksum &&
+                ValidateSnapshotShapes(Header, Shapes));
+   }
+   
+   if (Result)
+   {
+      Snapshot->ShapeCount = Header->ShapeCount;
+      Snapshot->Flags = Header->Flags;
+      Snapshot->Shapes = Shapes;
+      Snapshot->TotalCornerArea = Header->TotalCornerArea;
+      for (u32 Type = 0; Type < Shape_Count; ++Type)
+      {
+         Snapshot->TypeCount[Type] = Header->TypeCount[Type];
+      }
+      Snapshot->File = File;
+   }
+   else
+   {
+      UnmapFile(&File);
+   }
+   
+   return Result;
+}
+
+void UnloadSnapshot(shape_snapshot *Snapshot)
+{
+   UnmapFile(&Snapshot->File);
+   *Snapshot = {};
+}
+
+//- Shape arena
+// Bump allocator for shape_base collections. The shape classes are trivially
+// destructible, so a whole batch is released by resetting the arena instead of
+// deleting every object.
+
+static_assert(std::is_trivially_destructible<square>::value &&
+              std::is_trivially_destructible<rectangle>::value &&
+              std::is_trivially_destructible<triangle>::value &&
+              std::is_trivially_destructible<circle>::value,
+              "arena shapes are released without running destructors");
+
+struct shape_arena
+{
+   unsigned char *Base;
+   u64 Size;
+   u64 Used;
+};
+
+shape_arena MakeShapeArena(u64 Size)
+{
+   shape_arena Result = {};
+   Result.Base = (unsigned char *)malloc(Size);
+   Result.Size = Result.Base ? Size : 0;
+   
+   return Result;
+}
+
+// Running out of arena space (or an arena whose allocation failed) aborts; callers
+// size their arenas up front and have no way to continue without the shapes.
+void *PushSize(shape_arena *Arena, u64 Size, u64 Alignment)
+{
+   u64 Offset = (Arena->Used + (Alignment - 1)) & ~(Alignment - 1);
+   if (Offset > Arena->Size || Size > Arena->Size - Offset)
+   {
+      fprintf(stderr, "shape arena out of memory: %llu bytes requested, %llu of %llu used\n",
+              (unsigned long long)Size, (unsigned long long)Arena->Used, (unsigned long long)Arena->Size);
+      abort();
+   }
+   
+   Arena->Used = Offset + Size;
+   void *Result = Arena->Base + Offset;
+   
+   return Result;
+}
+
+// Constructs a shape in Arena. It is released with the arena, never deleted.
+template <typename shape, typename... shape_args>
+shape *PushShape(shape_arena *Arena, shape_args... Args)
+{
+   shape *Result = new (PushSize(Arena, sizeof(shape), alignof(shape))) shape(Args...);
+   return Result;
+}
+
+// O(1) release of everything pushed so far; the memory is reused by the next batch.
+void ResetShapeArena(shape_arena *Arena)
+{
+   Arena->Used = 0;
+}
+
+void FreeShapeArena(shape_arena *Arena)
+{
+   free(Arena->Base);
+   *Arena = {};
+}
+
+// All shapes share shape_base's alignment, so pushing them back to back needs no padding.
+static_assert(alignof(square) == alignof(shape_base) &&
+              alignof(rectangle) == alignof(shape_base) &&
+              alignof(triangle) == alignof(shape_base) &&
+              alignof(circle) == alignof(shape_base),
+              "arena shapes are packed without padding");
+
+// Worst-case arena size for GenerateShapesVTBLArena.
+u64 ShapeArenaSizeVTBL(u32 ShapeCount)
+{
+   u64 MaxShapeSize = sizeof(square);
+   if (sizeof(rectangle) > MaxShapeSize) MaxShapeSize = sizeof(rectangle);
+   if (sizeof(triangle) > MaxShapeSize) MaxShapeSize = sizeof(triangle);
+   if (sizeof(circle) > MaxShapeSize) MaxShapeSize = sizeof(circle);
+   
+   u64 Result = (u64)ShapeCount * (sizeof(shape_base *) + MaxShapeSize);
+   return Result;
+}
+
+shape_base **GenerateShapesVTBL(u32 ShapeCount)
+{
+   TimeBlock("GenerateShapesVTBL");
+   
+   shape_base **Shapes = (shape_base **)malloc(ShapeCount * sizeof(*Shapes));
+   for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+   {
+      u32 ShapeType = rand() % 4;
+      switch (ShapeType)
+      {
+         case 0: { Shapes[ShapeIndex] = new square(rand()); } break;
+         case 1: { Shapes[ShapeIndex] = new rectangle(rand(), rand()); } break;
+         case 2: { Shapes[ShapeIndex] = new triangle(rand(), rand()); } break;
+         case 3: { Shapes[ShapeIndex] = new circle(rand()); } break;
+         
+         default: { assert(false); } break;
+      }
+   }
+   
+   return Shapes;
+}
+
+void FreeShapesVTBL(u32 ShapeCount, shape_base **Shapes)
+{
+   TimeBlock("FreeShapesVTBL");
+   
+   for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+   {
+      delete Shapes[ShapeIndex];
+   }
+   free(Shapes);
+}
+
+// Same shapes as GenerateShapesVTBL, but the pointer array and the objects all live in
+// Arena and are released together by ResetShapeArena.
+shape_base **GenerateShapesVTBLArena(u32 ShapeCount, shape_arena *Arena)
+{
+   TimeBlock("GenerateShapesVTBLArena");
+   
+   shape_base **Shapes = (shape_base **)PushSize(Arena, ShapeCount * sizeof(*Shapes), alignof(shape_base *));
+   for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+   {
+      u32 ShapeType = rand() % 4;
+      switch (ShapeType)
+      {
+         case 0: { Shapes[ShapeIndex] = PushShape<square>(Arena, (f32)rand()); } break;
+         case 1: { Shapes[ShapeIndex] = PushShape<rectangle>(Arena, (f32)rand(), (f32)rand()); } break;
+         case 2: { Shapes[ShapeIndex] = PushShape<triangle>(Arena, (f32)rand(), (f32)rand()); } break;
+         case 3: { Shapes[ShapeIndex] = PushShape<circle>(Arena, (f32)rand()); } break;
+         
+         default: { assert(false); } break;
+      }
+   }
+   
+   return Shapes;
+}
+
+shape_union *GenerateShapesUnion(u32 ShapeCount)
+{
+   shape_union *Shapes;
+   {
+      TimeBlock("AllocateShapesUnion");
+      Shapes = (shape_union *)malloc(ShapeCount * sizeof(*Shapes));
+   }
+   
+   TimeBlock("ConstructShapesUnion");
+   
+   for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+   {
+      shape_union Shape;
+      Shape.Type = (shape_type)(rand() % 4);
+      Shape.Width = rand();
+      Shape.Height = rand();
+      switch (Shape.Type)
+      {
+         case Shape_Square:
+         case Shape_Circle: { Shape.Height = Shape.Width; } break;
+      }
+      
+      Shapes[ShapeIndex] = Shape;
+   }
+   
+   return Shapes;
+}
+
+f32 MeasureVTBL(char const *Name, f32 (*Function)(u32, shape_base **),
+                u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount)
+{
+   TimeBlock("MeasureVTBL");
+   
+   f32 BestMeasurement = INFINITY;
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      shape_base **Shapes = GenerateShapesVTBL(ShapeCount);
+      
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      
+      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
+      {
+         TimeBlock(Name);
+         f32 TotalArea = Function(ShapeCount, Shapes);
+      }
+      
+      u64 MeasurementNSec = EndTimeMeasurement(BeginTs);
+      
+      f32 Measurement = (f32)MeasurementNSec / (RepeatCount * ShapeCount);
+      if (Measurement < BestMeasurement)
+      {
+         BestMeasurement = Measurement;
+      }
+      
+      FreeShapesVTBL(ShapeCount, Shapes);
+   }
+   
+   return BestMeasurement;
+}
+
+volatile f32 AntiUnusedThrowAwayRegister;
+
+// MeasureVTBL with the shapes bump-allocated from one arena that is reset between
+// measurements instead of deleting every shape.
+f32 MeasureVTBLArena(char const *Name, f32 (*Function)(u32, shape_base **),
+                     u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount)
+{
+   TimeBlock("MeasureVTBLArena");
+   
+   shape_arena Arena = MakeShapeArena(ShapeArenaSizeVTBL(ShapeCount));
+   
+   f32 BestMeasurement = INFINITY;
+   f32 TotalAreaAccum = 0.0f;
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      shape_base **Shapes = GenerateShapesVTBLArena(ShapeCount, &Arena);
+      
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      
+      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
+      {
+         TimeBlock(Name);
+         f32 TotalArea = Function(ShapeCount, Shapes);
+         TotalAreaAccum += TotalArea;
+      }
+      
+      u64 MeasurementNSec = EndTimeMeasurement(BeginTs);
+      
+      f32 Measurement = (f32)MeasurementNSec / (RepeatCount * ShapeCount);
+      if (Measurement < BestMeasurement)
+      {
+         BestMeasurement = Measurement;
+      }
+      
+      ResetShapeArena(&Arena);
+   }
+   
+   FreeShapeArena(&Arena);
+   
+   AntiUnusedThrowAwayRegister += TotalAreaAccum;
+   
+   return BestMeasurement;
+}
+
+f32 MeasureUnion(char const *Name, f32 (*Function)(u32, shape_union *),
+                 u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount)
+{
+   TimeBlock("MeasureUnion");
+   
+   f32 BestMeasurement = INFINITY;
+   f32 TotalAreaAccum = 0.0f;
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      shape_union *Shapes = GenerateShapesUnion(ShapeCount);
+      
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      
+      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
+      {
+         TimeBlock(Name);
+         f32 TotalArea = Function(ShapeCount, Shapes);
+         TotalAreaAccum += TotalArea;
+      }
+      
+      u64 MeasurementNSec = EndTimeMeasurement(BeginTs);
+      
+      f32 Measurement = (f32)MeasurementNSec / (RepeatCount * ShapeCount);
+      if (Measurement < BestMeasurement)
+      {
+         BestMeasurement = Measurement;
+      }
+      
+      {
+         TimeBlock("FreeShapesUnion");
+         free(Shapes);
+      }
+   }
+   
+   AntiUnusedThrowAwayRegister += TotalAreaAccum;
+   
+   return BestMeasurement;
+}
+
+// Reorder cost is paid once per measurement and amortized over RepeatCount queries,
+// so the result is directly comparable with MeasureVTBL/MeasureUnion. The best reorder
+// cost and the best query-only cost (both ns/shape) are also returned on their own.
+f32 MeasureVTBLReordered(char const *Name, f32 (*Function)(u32, shape_base **), void (*Reorder)(u32, shape_base **),
+                         u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount,
+                         f32 *ReorderMeasurement, f32 *QueryMeasurement)
+{
+   TimeBlock("MeasureVTBLReordered");
+   
+   f32 BestMeasurement = INFINITY;
+   f32 BestReorderMeasurement = INFINITY;
+   f32 BestQueryMeasurement = INFINITY;
+   f32 TotalAreaAccum = 0.0f;
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      shape_base **Shapes = GenerateShapesVTBL(ShapeCount);
+      
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      
+      {
+         TimeBlock("Reorder");
+         Reorder(ShapeCount, Shapes);
+      }
+      
+      u64 ReorderNSec = EndTimeMeasurement(BeginTs);
+      
+      BeginTimeMeasurement(&BeginTs);
+      
+      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
+      {
+         TimeBlock(Name);
+         f32 TotalArea = Function(ShapeCount, Shapes);
+         TotalAreaAccum += TotalArea;
+      }
+      
+      u64 QueryNSec = EndTimeMeasurement(BeginTs);
+      
+      f32 Measurement = (f32)(ReorderNSec + QueryNSec) / (RepeatCount * ShapeCount);
+      if (Measurement < BestMeasurement)
+      {
+         BestMeasurement = Measurement;
+      }
+      
+      f32 ReorderCost = (f32)ReorderNSec / ShapeCount;
+      if (ReorderCost < BestReorderMeasurement)
+      {
+         BestReorderMeasurement = ReorderCost;
+      }
+      
+      f32 QueryCost = (f32)QueryNSec / (RepeatCount * ShapeCount);
+      if (QueryCost < BestQueryMeasurement)
+      {
+         BestQueryMeasurement = QueryCost;
+      }
+      
+      FreeShapesVTBL(ShapeCount, Shapes);
+   }
+   
+   AntiUnusedThrowAwayRegister += TotalAreaAccum;
+   *ReorderMeasurement = BestReorderMeasurement;
+   *QueryMeasurement = BestQueryMeasurement;
+   
+   return BestMeasurement;
+}
+
+f32 MeasureUnionReordered(char const *Name, f32 (*Function)(u32, shape_union *), void (*Reorder)(u32, shape_union *),
+                          u32 ShapeCount, u32 MeasurementsPerTest, u32 RepeatCount,
+                          f32 *ReorderMeasurement, f32 *QueryMeasurement)
+{
+   TimeBlock("MeasureUnionReordered");
+   
+   f32 BestMeasurement = INFINITY;
+   f32 BestReorderMeasurement = INFINITY;
+   f32 BestQueryMeasurement = INFINITY;
+   f32 TotalAreaAccum = 0.0f;
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      shape_union *Shapes = GenerateShapesUnion(ShapeCount);
+      
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      
+      {
+         TimeBlock("Reorder");
+         Reorder(ShapeCount, Shapes);
+      }
+      
+      u64 ReorderNSec = EndTimeMeasurement(BeginTs);
+      
+      BeginTimeMeasurement(&BeginTs);
+      
+      for (u32 RepeatIndex = 0; RepeatIndex < RepeatCount; ++RepeatIndex)
+      {
+         TimeBlock(Name);
+         f32 TotalArea = Function(ShapeCount, Shapes);
+         TotalAreaAccum += TotalArea;
+      }
+      
+      u64 QueryNSec = EndTimeMeasurement(BeginTs);
+      
+      f32 Measurement = (f32)(ReorderNSec + QueryNSec) / (RepeatCount * ShapeCount);
+      if (Measurement < BestMeasurement)
+      {
+         BestMeasurement = Measurement;
+      }
+      
+      f32 ReorderCost = (f32)ReorderNSec / ShapeCount;
+      if (ReorderCost < BestReorderMeasurement)
+      {
+         BestReorderMeasurement = ReorderCost;
+      }
+      
+      f32 QueryCost = (f32)QueryNSec / (RepeatCount * ShapeCount);
+      if (QueryCost < BestQueryMeasurement)
+      {
+         BestQueryMeasurement = QueryCost;
+      }
+      
+      {
+         TimeBlock("FreeShapesUnion");
+         free(Shapes);
+      }
+   }
+   
+   AntiUnusedThrowAwayRegister += TotalAreaAccum;
+   *ReorderMeasurement = BestReorderMeasurement;
+   *QueryMeasurement = BestQueryMeasurement;
+   
+   return BestMeasurement;
+}
+
+// Number of queries after which reordering once is cheaper than querying unsorted data.
+// All three costs are ns/shape; SortedQuery is the measured query-only time.
+f32 ReorderBreakEven(f32 Unsorted, f32 SortedQuery, f32 ReorderCost)
+{
+   f32 Gain = Unsorted - SortedQuery;
+   f32 Result = (Gain > 0.0f) ? (ReorderCost / Gain) : INFINITY;
+   
+   return Result;
+}
+
+void Measure(u32 RepeatCount)
+{
+   printf("Repeat Count: %d\n", RepeatCount);
+   
+   printf("\n");
+   
+   u32 ShapeCount = 1048576;
+   u32 MeasurementsPerTest = 10;
+   
+   printf("%30s(%d): ", "CornerAreaVTBL", ShapeCount); fflush(stdout);
+   f32 MeasurementVTBL = MeasureVTBL("CornerAreaVTBL", &CornerAreaVTBL, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementVTBL);
+   
+   printf("%30s(%d): ", "CornerAreaVTBL4", ShapeCount); fflush(stdout);
+   f32 MeasurementVTBL4 = MeasureVTBL("CornerAreaVTBL4", &CornerAreaVTBL4, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementVTBL4);
+   
+   printf("%30s(%d): ", "CornerAreaVTBL (arena)", ShapeCount); fflush(stdout);
+   f32 MeasurementArenaVTBL = MeasureVTBLArena("CornerAreaVTBL (arena)", &CornerAreaVTBL, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementArenaVTBL);
+   
+   printf("%30s(%d): ", "CornerAreaSwitch", ShapeCount); fflush(stdout);
+   f32 MeasurementSwitch = MeasureUnion("CornerAreaSwitch", &CornerAreaSwitch, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementSwitch);
+   
+   printf("%30s(%d): ", "CornerAreaSwitch4", ShapeCount); fflush(stdout);
+   f32 MeasurementSwitch4 = MeasureUnion("CornerAreaSwitch4", &CornerAreaSwitch4, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementSwitch4);
+   
+   printf("%30s(%d): ", "CornerAreaTable", ShapeCount); fflush(stdout);
+   f32 MeasurementTable = MeasureUnion("CornerAreaTable", &CornerAreaTable, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementTable);
    
    printf("%30s(%d): ", "CornerAreaTable4", ShapeCount); fflush(stdout);
-   f32 MeasurementTable4 = MeasureUnion(&CornerAreaTable4, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementTable4 = MeasureUnion("CornerAreaTable4", &CornerAreaTable4, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementTable4);
    
+   printf("%30s(%d): ", "CornerAreaBranchless<8>", ShapeCount); fflush(stdout);
+   f32 MeasurementBranchless8 = MeasureUnion("CornerAreaBranchless<8>", &CornerAreaBranchless<8>, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementBranchless8);
+   
+   printf("%30s(%d): ", "CornerAreaBranchless<16>", ShapeCount); fflush(stdout);
+   f32 MeasurementBranchless16 = MeasureUnion("CornerAreaBranchless<16>", &CornerAreaBranchless<16>, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementBranchless16);
+   
+   printf("%30s(%d): ", "CornerAreaBranchless<32>", ShapeCount); fflush(stdout);
+   f32 MeasurementBranchless32 = MeasureUnion("CornerAreaBranchless<32>", &CornerAreaBranchless<32>, ShapeCount, MeasurementsPerTest, RepeatCount);
+   printf("%f ns/shape\n", MeasurementBranchless32);
+   
+#if CLEANCODE_SIMD
    printf("%30s(%d): ", "CornerAreaTableSIMD", ShapeCount); fflush(stdout);
-   f32 MeasurementSIMD = MeasureUnion(&CornerAreaTableSIMD, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementSIMD = MeasureUnion("CornerAreaTableSIMD", &CornerAreaTableSIMD, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementSIMD);
    
    printf("%30s(%d): ", "CornerAreaTableSIMD2", ShapeCount); fflush(stdout);
-   f32 MeasurementSIMD2 = MeasureUnion(&CornerAreaTableSIMD2, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementSIMD2 = MeasureUnion("CornerAreaTableSIMD2", &CornerAreaTableSIMD2, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementSIMD2);
    
    printf("%30s(%d): ", "CornerAreaTableSIMD4", ShapeCount); fflush(stdout);
-   f32 MeasurementSIMD4 = MeasureUnion(&CornerAreaTableSIMD4, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementSIMD4 = MeasureUnion("CornerAreaTableSIMD4", &CornerAreaTableSIMD4, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementSIMD4);
+#endif
    
+#if CLEANCODE_AVX
    printf("%30s(%d): ", "CornerAreaTableSIMD256", ShapeCount); fflush(stdout);
-   f32 MeasurementSIMD256 = MeasureUnion(&CornerAreaTableSIMD256, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementSIMD256 = MeasureUnion("CornerAreaTableSIMD256", &CornerAreaTableSIMD256, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementSIMD256);
    
    printf("%30s(%d): ", "CornerAreaTableSIMD256_2", ShapeCount); fflush(stdout);
-   f32 MeasurementSIMD256_2 = MeasureUnion(&CornerAreaTableSIMD256_2, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementSIMD256_2 = MeasureUnion("CornerAreaTableSIMD256_2", &CornerAreaTableSIMD256_2, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementSIMD256_2);
    
    printf("%30s(%d): ", "CornerAreaTableSIMD256_4", ShapeCount); fflush(stdout);
-   f32 MeasurementSIMD256_4 = MeasureUnion(&CornerAreaTableSIMD256_4, ShapeCount, MeasurementsPerTest, RepeatCount);
+   f32 MeasurementSIMD256_4 = MeasureUnion("CornerAreaTableSIMD256_4", &CornerAreaTableSIMD256_4, ShapeCount, MeasurementsPerTest, RepeatCount);
    printf("%f ns/shape\n", MeasurementSIMD256_4);
+#endif
+   
+   printf("\n");
+   
+   printf("Reordered by type (reorder cost amortized over %d queries)\n", RepeatCount);
+   
+   printf("\n");
+   
+   f32 ReorderVTBL;
+   f32 QueryVTBL;
+   printf("%30s(%d): ", "CornerAreaVTBL", ShapeCount); fflush(stdout);
+   f32 MeasurementSortedVTBL = MeasureVTBLReordered("CornerAreaVTBL (sorted)", &CornerAreaVTBL, &ReorderVTBLByType, ShapeCount, MeasurementsPerTest, RepeatCount, &ReorderVTBL, &QueryVTBL);
+   printf("%f ns/shape\n", MeasurementSortedVTBL);
+   
+   f32 ReorderVTBL4;
+   f32 QueryVTBL4;
+   printf("%30s(%d): ", "CornerAreaVTBL4", ShapeCount); fflush(stdout);
+   f32 MeasurementSortedVTBL4 = MeasureVTBLReordered("CornerAreaVTBL4 (sorted)", &CornerAreaVTBL4, &ReorderVTBLByType, ShapeCount, MeasurementsPerTest, RepeatCount, &ReorderVTBL4, &QueryVTBL4);
+   printf("%f ns/shape\n", MeasurementSortedVTBL4);
+   
+   f32 ReorderSwitch;
+   f32 QuerySwitch;
+   printf("%30s(%d): ", "CornerAreaSwitch", ShapeCount); fflush(stdout);
+   f32 MeasurementSortedSwitch = MeasureUnionReordered("CornerAreaSwitch (sorted)", &CornerAreaSwitch, &ReorderUnionByType, ShapeCount, MeasurementsPerTest, RepeatCount, &ReorderSwitch, &QuerySwitch);
+   printf("%f ns/shape\n", MeasurementSortedSwitch);
+   
+   f32 ReorderSwitch4;
+   f32 QuerySwitch4;
+   printf("%30s(%d): ", "CornerAreaSwitch4", ShapeCount); fflush(stdout);
+   f32 MeasurementSortedSwitch4 = MeasureUnionReordered("CornerAreaSwitch4 (sorted)", &CornerAreaSwitch4, &ReorderUnionByType, ShapeCount, MeasurementsPerTest, RepeatCount, &ReorderSwitch4, &QuerySwitch4);
+   printf("%f ns/shape\n", MeasurementSortedSwitch4);
+   
+   f32 ReorderTable4;
+   f32 QueryTable4;
+   printf("%30s(%d): ", "CornerAreaTable4", ShapeCount); fflush(stdout);
+   f32 MeasurementSortedTable4 = MeasureUnionReordered("CornerAreaTable4 (sorted)", &CornerAreaTable4, &ReorderUnionByType, ShapeCount, MeasurementsPerTest, RepeatCount, &ReorderTable4, &QueryTable4);
+   printf("%f ns/shape\n", MeasurementSortedTable4);
+   
+   printf("%30s: %f ns/shape\n", "ReorderVTBLByType (VTBL)", ReorderVTBL);
+   printf("%30s: %f ns/shape\n", "ReorderVTBLByType (VTBL4)", ReorderVTBL4);
+   printf("%30s: %f ns/shape\n", "ReorderUnionByType (Switch)", ReorderSwitch);
+   printf("%30s: %f ns/shape\n", "ReorderUnionByType (Switch4)", ReorderSwitch4);
+   printf("%30s: %f ns/shape\n", "ReorderUnionByType (Table4)", ReorderTable4);
+   
+   printf("\n");
+   
+   printf("%30s: %f ns/shape\n", "CornerAreaVTBL (sorted query)", QueryVTBL);
+   printf("%30s: %f ns/shape\n", "CornerAreaVTBL4 (sorted query)", QueryVTBL4);
+   printf("%30s: %f ns/shape\n", "CornerAreaSwitch (sorted query)", QuerySwitch);
+   printf("%30s: %f ns/shape\n", "CornerAreaSwitch4 (sorted query)", QuerySwitch4);
+   printf("%30s: %f ns/shape\n", "CornerAreaTable4 (sorted query)", QueryTable4);
+   
+   printf("\n");
+   
+   printf("%30s: %f queries\n", "CornerAreaVTBL break-even", ReorderBreakEven(MeasurementVTBL, QueryVTBL, ReorderVTBL));
+   printf("%30s: %f queries\n", "CornerAreaVTBL4 break-even", ReorderBreakEven(MeasurementVTBL4, QueryVTBL4, ReorderVTBL4));
+   printf("%30s: %f queries\n", "CornerAreaSwitch break-even", ReorderBreakEven(MeasurementSwitch, QuerySwitch, ReorderSwitch));
+   printf("%30s: %f queries\n", "CornerAreaSwitch4 break-even", ReorderBreakEven(MeasurementSwitch4, QuerySwitch4, ReorderSwitch4));
+   printf("%30s: %f queries\n", "CornerAreaTable4 break-even", ReorderBreakEven(MeasurementTable4, QueryTable4, ReorderTable4));
    
    printf("\n");
    
    f32 SpeedupVTBL = MeasurementVTBL / MeasurementVTBL;
    f32 SpeedupVTBL4 = MeasurementVTBL / MeasurementVTBL4;
+   f32 SpeedupArenaVTBL = MeasurementVTBL / MeasurementArenaVTBL;
    f32 SpeedupSwitch = MeasurementVTBL / MeasurementSwitch;
    f32 SpeedupSwitch4 = MeasurementVTBL / MeasurementSwitch4;
    f32 SpeedupTable = MeasurementVTBL / MeasurementTable;
    f32 SpeedupTable4 = MeasurementVTBL / MeasurementTable4;
+   f32 SpeedupBranchless8 = MeasurementVTBL / MeasurementBranchless8;
+   f32 SpeedupBranchless16 = MeasurementVTBL / MeasurementBranchless16;
+   f32 SpeedupBranchless32 = MeasurementVTBL / MeasurementBranchless32;
+#if CLEANCODE_SIMD
    f32 SpeedupSIMD = MeasurementVTBL / MeasurementSIMD;
    f32 SpeedupSIMD2 = MeasurementVTBL / MeasurementSIMD2;
    f32 SpeedupSIMD4 = MeasurementVTBL / MeasurementSIMD4;
+#endif
+#if CLEANCODE_AVX
    f32 SpeedupSIMD256 = MeasurementVTBL / MeasurementSIMD256;
    f32 SpeedupSIMD256_2 = MeasurementVTBL / MeasurementSIMD256_2;
    f32 SpeedupSIMD256_4 = MeasurementVTBL / MeasurementSIMD256_4;
+#endif
+   f32 SpeedupSortedVTBL = MeasurementVTBL / MeasurementSortedVTBL;
+   f32 SpeedupSortedVTBL4 = MeasurementVTBL / MeasurementSortedVTBL4;
+   f32 SpeedupSortedSwitch = MeasurementVTBL / MeasurementSortedSwitch;
+   f32 SpeedupSortedSwitch4 = MeasurementVTBL / MeasurementSortedSwitch4;
+   f32 SpeedupSortedTable4 = MeasurementVTBL / MeasurementSortedTable4;
    
    printf("%30s: %fx\n", "CornerAreaVTBL", SpeedupVTBL);
    printf("%30s: %fx\n", "CornerAreaVTBL4", SpeedupVTBL4);
+   printf("%30s: %fx\n", "CornerAreaVTBL (arena)", SpeedupArenaVTBL);
    printf("%30s: %fx\n", "CornerAreaSwitch", SpeedupSwitch);
    printf("%30s: %fx\n", "CornerAreaSwitch4", SpeedupSwitch4);
    printf("%30s: %fx\n", "CornerAreaTable", SpeedupTable);
    printf("%30s: %fx\n", "CornerAreaTable4", SpeedupTable4);
+   printf("%30s: %fx\n", "CornerAreaBranchless<8>", SpeedupBranchless8);
+   printf("%30s: %fx\n", "CornerAreaBranchless<16>", SpeedupBranchless16);
+   printf("%30s: %fx\n", "CornerAreaBranchless<32>", SpeedupBranchless32);
+#if CLEANCODE_SIMD
    printf("%30s: %fx\n", "CornerAreaTableSIMD", SpeedupSIMD);
    printf("%30s: %fx\n", "CornerAreaTableSIMD2", SpeedupSIMD2);
    printf("%30s: %fx\n", "CornerAreaTableSIMD4", SpeedupSIMD4);
+#endif
+#if CLEANCODE_AVX
    printf("%30s: %fx\n", "CornerAreaTableSIMD256", SpeedupSIMD256);
    printf("%30s: %fx\n", "CornerAreaTableSIMD256_2", SpeedupSIMD256_2);
    printf("%30s: %fx\n", "CornerAreaTableSIMD256_4", SpeedupSIMD256_4);
+#endif
+   printf("%30s: %fx\n", "CornerAreaVTBL (sorted)", SpeedupSortedVTBL);
+   printf("%30s: %fx\n", "CornerAreaVTBL4 (sorted)", SpeedupSortedVTBL4);
+   printf("%30s: %fx\n", "CornerAreaSwitch (sorted)", SpeedupSortedSwitch);
+   printf("%30s: %fx\n", "CornerAreaSwitch4 (sorted)", SpeedupSortedSwitch4);
+   printf("%30s: %fx\n", "CornerAreaTable4 (sorted)", SpeedupSortedTable4);
+   
+   printf("\n");
+}
+
+// Cost of keeping data sorted through sorted_shape_array (one remove + one insert per
+// update) versus reordering the whole unsorted array with Reorder*ByType.
+void MeasureSortedUpdates(u32 ShapeCount, u32 UpdateCount, u32 MeasurementsPerTest)
+{
+   TimeBlock("MeasureSortedUpdates");
+   
+   printf("Incremental updates vs full reorder (%d shapes, %d updates)\n", ShapeCount, UpdateCount);
+   
+   printf("\n");
+   
+   f32 BestUpdateUnion = INFINITY;
+   f32 BestReorderUnion = INFINITY;
+   f32 BestUpdateVTBL = INFINITY;
+   f32 BestReorderVTBL = INFINITY;
+   f32 Accum = 0.0f;
+   
+   u32 *RemoveIndices = (u32 *)malloc(UpdateCount * sizeof(*RemoveIndices));
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      for (u32 UpdateIndex = 0; UpdateIndex < UpdateCount; ++UpdateIndex)
+      {
+         RemoveIndices[UpdateIndex] = rand() % ShapeCount;
+      }
+      
+      {
+         shape_union *Shapes = GenerateShapesUnion(ShapeCount);
+         shape_union *NewShapes = GenerateShapesUnion(UpdateCount);
+         
+         sorted_shape_array<shape_union> Sorted = MakeSortedShapeArray<shape_union>(ShapeCount);
+         for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+         {
+            InsertSorted(&Sorted, Shapes[ShapeIndex]);
+         }
+         
+         timestamp BeginTs;
+         BeginTimeMeasurement(&BeginTs);
+         for (u32 UpdateIndex = 0; UpdateIndex < UpdateCount; ++UpdateIndex)
+         {
+            Accum += RemoveSorted(&Sorted, RemoveIndices[UpdateIndex]).Width;
+            InsertSorted(&Sorted, NewShapes[UpdateIndex]);
+         }
+         f32 Update = (f32)EndTimeMeasurement(BeginTs) / UpdateCount;
+         if (Update < BestUpdateUnion) BestUpdateUnion = Update;
+         
+         BeginTimeMeasurement(&BeginTs);
+         ReorderUnionByType(ShapeCount, Shapes);
+         f32 Reorder = (f32)EndTimeMeasurement(BeginTs);
+         if (Reorder < BestReorderUnion) BestReorderUnion = Reorder;
+         
+         Accum += Sorted.Shapes[0].Width + Shapes[0].Width;
+         FreeSortedShapeArray(&Sorted);
+         free(NewShapes);
+         free(Shapes);
+      }
+      
+      {
+         shape_base **Shapes = GenerateShapesVTBL(ShapeCount);
+         shape_base **NewShapes = GenerateShapesVTBL(UpdateCount);
+         
+         sorted_shape_array<shape_base *> Sorted = MakeSortedShapeArray<shape_base *>(ShapeCount);
+         for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+         {
+            InsertSorted(&Sorted, Shapes[ShapeIndex]);
+         }
+         
+         timestamp BeginTs;
+         BeginTimeMeasurement(&BeginTs);
+         for (u32 UpdateIndex = 0; UpdateIndex < UpdateCount; ++UpdateIndex)
+         {
+            // Removed shapes stay owned by Shapes/NewShapes and are freed with them below.
+            RemoveSorted(&Sorted, RemoveIndices[UpdateIndex]);
+            InsertSorted(&Sorted, NewShapes[UpdateIndex]);
+         }
+         f32 Update = (f32)EndTimeMeasurement(BeginTs) / UpdateCount;
+         if (Update < BestUpdateVTBL) BestUpdateVTBL = Update;
+         
+         BeginTimeMeasurement(&BeginTs);
+         ReorderVTBLByType(ShapeCount, Shapes);
+         f32 Reorder = (f32)EndTimeMeasurement(BeginTs);
+         if (Reorder < BestReorderVTBL) BestReorderVTBL = Reorder;
+         
+         Accum += (f32)Sorted.BucketEnd[0];
+         FreeSortedShapeArray(&Sorted);
+         FreeShapesVTBL(UpdateCount, NewShapes);
+         FreeShapesVTBL(ShapeCount, Shapes);
+      }
+   }
+   free(RemoveIndices);
+   
+   AntiUnusedThrowAwayRegister += Accum;
+   
+   printf("%30s: %f ns/update\n", "sorted_shape_array (union)", BestUpdateUnion);
+   printf("%30s: %f ms\n", "ReorderUnionByType", BestReorderUnion / 1000000.0f);
+   printf("%30s: %f updates\n", "union break-even", BestReorderUnion / BestUpdateUnion);
+   printf("%30s: %f ns/update\n", "sorted_shape_array (VTBL)", BestUpdateVTBL);
+   printf("%30s: %f ms\n", "ReorderVTBLByType", BestReorderVTBL / 1000000.0f);
+   printf("%30s: %f updates\n", "VTBL break-even", BestReorderVTBL / BestUpdateVTBL);
+   
+   printf("\n");
+}
+
+void MeasureFootprint(u32 ShapeCount, u32 MeasurementsPerTest)
+{
+   TimeBlock("MeasureFootprint");
+   
+   printf("Memory footprint and teardown (%d shapes)\n", ShapeCount);
+   
+   printf("\n");
+   
+   f32 BytesVTBLHeap = 0.0f;
+   f32 BytesVTBLArena = 0.0f;
+   f32 BestGenerateHeap = INFINITY;
+   f32 BestGenerateArena = INFINITY;
+   f32 BestFreeHeap = INFINITY;
+   f32 BestResetArena = INFINITY;
+   
+   shape_arena Arena = MakeShapeArena(ShapeArenaSizeVTBL(ShapeCount));
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      shape_base **Shapes = GenerateShapesVTBL(ShapeCount);
+      f32 GenerateHeap = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (GenerateHeap < BestGenerateHeap) BestGenerateHeap = GenerateHeap;
+      
+      if (MeasurementIndex == 0)
+      {
+         u64 HeapBytes = HeapBlockFootprint(Shapes);
+         for (u32 ShapeIndex = 0; ShapeIndex < ShapeCount; ++ShapeIndex)
+         {
+            HeapBytes += HeapBlockFootprint(Shapes[ShapeIndex]);
+         }
+         BytesVTBLHeap = (f32)HeapBytes / ShapeCount;
+      }
+      
+      BeginTimeMeasurement(&BeginTs);
+      FreeShapesVTBL(ShapeCount, Shapes);
+      f32 FreeHeap = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (FreeHeap < BestFreeHeap) BestFreeHeap = FreeHeap;
+      
+      BeginTimeMeasurement(&BeginTs);
+      Shapes = GenerateShapesVTBLArena(ShapeCount, &Arena);
+      f32 GenerateArena = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (GenerateArena < BestGenerateArena) BestGenerateArena = GenerateArena;
+      
+      if (MeasurementIndex == 0)
+      {
+         BytesVTBLArena = (f32)Arena.Used / ShapeCount;
+      }
+      
+      BeginTimeMeasurement(&BeginTs);
+      ResetShapeArena(&Arena);
+      f32 ResetArena = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (ResetArena < BestResetArena) BestResetArena = ResetArena;
+   }
+   FreeShapeArena(&Arena);
+   
+   // SoA and packed are not stored anywhere in this program; their sizes follow from
+   // the fields: type, width, height in separate arrays, and a one-byte type tag.
+   f32 BytesUnion = sizeof(shape_union);
+   f32 BytesSoA = sizeof(shape_type) + 2*sizeof(f32);
+   f32 BytesPacked = sizeof(unsigned char) + 2*sizeof(f32);
+   
+   printf("%30s: %f bytes/shape\n", "VTBL (new/delete)", BytesVTBLHeap);
+   printf("%30s: %f bytes/shape\n", "VTBL (arena)", BytesVTBLArena);
+   printf("%30s: %f bytes/shape\n", "shape_union", BytesUnion);
+   printf("%30s: %f bytes/shape\n", "SoA (computed)", BytesSoA);
+   printf("%30s: %f bytes/shape\n", "packed (computed)", BytesPacked);
+   
+   printf("\n");
+   
+   printf("%30s: %f ms\n", "Generate VTBL (new)", BestGenerateHeap);
+   printf("%30s: %f ms\n", "Generate VTBL (arena)", BestGenerateArena);
+   printf("%30s: %f ms\n", "Teardown VTBL (delete)", BestFreeHeap);
+   printf("%30s: %f ms\n", "Teardown VTBL (arena reset)", BestResetArena);
+   
+   printf("\n");
+}
+
+void MeasureSnapshot(u32 ShapeCount, u32 MeasurementsPerTest)
+{
+   TimeBlock("MeasureSnapshot");
+   
+   char const *SnapshotPath = "shapes.snapshot";
+   
+   printf("Snapshot restart (%d shapes, warm page cache)\n", ShapeCount);
+   
+   printf("\n");
+   
+   f32 BestRebuild = INFINITY;
+   f32 BestLoadVerified = INFINITY;
+   f32 BestLoad = INFINITY;
+   f32 BestFirstQuery = INFINITY;
+   f32 TotalAreaAccum = 0.0f;
+   char const *Error = 0;
+   for (u32 MeasurementIndex = 0; MeasurementIndex < MeasurementsPerTest; ++MeasurementIndex)
+   {
+      timestamp BeginTs;
+      BeginTimeMeasurement(&BeginTs);
+      
+      shape_union *Shapes = GenerateShapesUnion(ShapeCount);
+      TotalAreaAccum += CornerAreaTable(ShapeCount, Shapes);
+      
+      f32 Rebuild = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (Rebuild < BestRebuild) BestRebuild = Rebuild;
+      
+      ReorderUnionByType(ShapeCount, Shapes);
+      if (!WriteSnapshot(SnapshotPath, ShapeCount, Shapes))
+      {
+         Error = "write failed";
+         free(Shapes);
+         break;
+      }
+      
+      shape_snapshot Snapshot;
+      
+      BeginTimeMeasurement(&BeginTs);
+      bool Loaded = LoadSnapshot(SnapshotPath, &Snapshot, true);
+      TotalAreaAccum += Snapshot.TotalCornerArea;
+      f32 LoadVerified = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      UnloadSnapshot(&Snapshot);
+      if (!Loaded)
+      {
+         Error = "verified load failed";
+         free(Shapes);
+         break;
+      }
+      if (LoadVerified < BestLoadVerified) BestLoadVerified = LoadVerified;
+      
+      BeginTimeMeasurement(&BeginTs);
+      Loaded = LoadSnapshot(SnapshotPath, &Snapshot, false);
+      TotalAreaAccum += Snapshot.TotalCornerArea;
+      f32 Load = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (!Loaded || !(Snapshot.Flags & SnapshotFlag_SortedByType))
+      {
+         Error = Loaded ? "snapshot not flagged as sorted" : "trusted load failed";
+         UnloadSnapshot(&Snapshot);
+         free(Shapes);
+         break;
+      }
+      if (Load < BestLoad) BestLoad = Load;
+      
+      BeginTimeMeasurement(&BeginTs);
+      {
+         TimeBlock("CornerAreaTable4 (snapshot)");
+         TotalAreaAccum += CornerAreaTable4(Snapshot.ShapeCount, Snapshot.Shapes);
+      }
+      f32 FirstQuery = EndTimeMeasurement(BeginTs) / 1000000.0f;
+      if (FirstQuery < BestFirstQuery) BestFirstQuery = FirstQuery;
+      
+      UnloadSnapshot(&Snapshot);
+      free(Shapes);
+   }
+   
+   remove(SnapshotPath);
+   AntiUnusedThrowAwayRegister += TotalAreaAccum;
+   
+   if (Error)
+   {
+      fprintf(stderr, "snapshot benchmark aborted: %s (%s)\n", Error, SnapshotPath);
+      return;
+   }
+   
+   printf("%30s: %f ms\n", "Rebuild + total", BestRebuild);
+   printf("%30s: %f ms\n", "Load snapshot (verified)", BestLoadVerified);
+   printf("%30s: %f ms\n", "Load snapshot (trusted)", BestLoad);
+   printf("%30s: %f ms\n", "First CornerAreaTable4 query", BestFirstQuery);
    
    printf("\n");
 }
@@ -668,6 +1994,13 @@ int main()
    
    Measure(1);
    Measure(100);
+   MeasureSortedUpdates(1048576, 4096, 10);
+   MeasureSnapshot(1048576, 10);
+   MeasureFootprint(1048576, 10);
+   
+#if CLEANCODE_TRACE
+   WriteChromeTrace("cleancode_trace.json");
+#endif
    
 #else
    
@@ -700,13 +2033,17 @@ int main()
    
    f32 Table = CornerAreaTable(ShapeCount, Shapes);
    f32 Switch = CornerAreaSwitch(ShapeCount, Shapes);
+#if CLEANCODE_SIMD
    f32 SIMD = CornerAreaTableSIMD(ShapeCount, Shapes);
    f32 SIMD4 = CornerAreaTableSIMD4(ShapeCount, Shapes);
+#endif
    
    printf("Table = %f\n", Table);
    printf("Switch = %f\n", Switch);
+#if CLEANCODE_SIMD
    printf("SIMD  = %f\n", SIMD );
    printf("SIMD4 = %f\n", SIMD4);
+#endif
    
 #endif
    
@@ -27,3 +27,73 @@ u64 EndTimeMeasurement(timestamp BeginTs)
 
    return DiffNsec;
 }
+
+// Tick source for trace scopes: the TSC on x86, nanoseconds from clock_gettime elsewhere.
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+u64 ReadCPUTimer(void)
+{
+   return __rdtsc();
+}
+#else
+u64 ReadCPUTimer(void)
+{
+   timestamp Ts;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &Ts);
+   return (u64)Ts.tv_sec * 1000000000 + Ts.tv_nsec;
+}
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct mapped_file
+{
+   void *Data;
+   u64 Size;
+};
+
+mapped_file MapFileReadOnly(char const *Path)
+{
+   mapped_file Result = {};
+   
+   int File = open(Path, O_RDONLY);
+   if (File != -1)
+   {
+      struct stat Stat;
+      if (fstat(File, &Stat) == 0 && Stat.st_size > 0)
+      {
+         void *Data = mmap(0, Stat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+         if (Data != MAP_FAILED)
+         {
+            Result.Data = Data;
+            Result.Size = Stat.st_size;
+         }
+      }
+      close(File);
+   }
+   
+   return Result;
+}
+
+void UnmapFile(mapped_file *File)
+{
+   if (File->Data)
+   {
+      munmap(File->Data, File->Size);
+   }
+   *File = {};
+}
+
+#include <malloc.h>
+
+// Heap bytes taken by one malloc block: the usable size plus the size_t chunk header.
+// Exact for glibc's small chunks; malloc_usable_size is also available on musl, where the
+// result is an estimate.
+u64 HeapBlockFootprint(void *Memory)
+{
+   return malloc_usable_size(Memory) + sizeof(size_t);
+}
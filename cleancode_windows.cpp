@@ -1,4 +1,6 @@
 #include <windows.h>
+#include <intrin.h>
+#include <malloc.h>
 
 typedef LARGE_INTEGER timestamp;
 
@@ -20,3 +22,66 @@ u64 EndTimeMeasurement(timestamp BeginTs)
    
    return DiffNSec;
 }
+
+// Tick source for trace scopes: the TSC on x86, the performance counter elsewhere.
+u64 ReadCPUTimer(void)
+{
+#if defined(_M_X64) || defined(_M_IX86)
+   return __rdtsc();
+#else
+   LARGE_INTEGER Counter;
+   QueryPerformanceCounter(&Counter);
+   return Counter.QuadPart;
+#endif
+}
+
+struct mapped_file
+{
+   void *Data;
+   u64 Size;
+};
+
+mapped_file MapFileReadOnly(char const *Path)
+{
+   mapped_file Result = {};
+   
+   HANDLE File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+   if (File != INVALID_HANDLE_VALUE)
+   {
+      LARGE_INTEGER Size;
+      if (GetFileSizeEx(File, &Size) && Size.QuadPart > 0)
+      {
+         HANDLE Mapping = CreateFileMappingA(File, 0, PAGE_READONLY, 0, 0, 0);
+         if (Mapping)
+         {
+            void *Data = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+            if (Data)
+            {
+               Result.Data = Data;
+               Result.Size = Size.QuadPart;
+            }
+            CloseHandle(Mapping);
+         }
+      }
+      CloseHandle(File);
+   }
+   
+   return Result;
+}
+
+void UnmapFile(mapped_file *File)
+{
+   if (File->Data)
+   {
+      UnmapViewOfFile(File->Data);
+   }
+   *File = {};
+}
+
+// Heap bytes taken by one malloc block: the requested size plus the heap entry header,
+// rounded up to the heap granularity (both two pointers wide).
+u64 HeapBlockFootprint(void *Memory)
+{
+   u64 Granularity = 2*sizeof(void *);
+   return (_msize(Memory) + Granularity + (Granularity - 1)) & ~(Granularity - 1);
+}